@@ -0,0 +1,78 @@
+/*****************************************************************************
+Arduino library handling ping messages for the esp8266 platform
+
+MIT License
+
+Copyright (c) 2018 Alessio Leoncini
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*****************************************************************************/
+
+#include <Pinger.h>
+#include <ESP8266WiFi.h>
+
+// Set global to avoid object removing after setup() routine
+Pinger pinger;
+
+void setup()
+{  
+  // Begin serial connection at 9600 baud
+  Serial.begin(9600);
+  
+  // Connect to WiFi access point
+  bool stationConnected = WiFi.begin(
+  "wifissid",
+  "wifipassword");
+
+  // Check if connection errors
+  if(!stationConnected)
+  {
+    Serial.println("Error, unable to connect specified WiFi network.");
+  }
+  
+  // Wait connection completed
+  Serial.print("Connecting to AP...");
+  while(WiFi.status() != WL_CONNECTED)
+  {
+    delay(500);
+    Serial.print(".");
+  }
+  Serial.print("Ok\n");
+
+  // Answer echo requests, at most 50 per second for every source, adding
+  // receive and transmit timestamps to the echo payload
+  if(pinger.StartReflector(50, true) == false)
+  {
+    Serial.println("Error, unable to start reflector.");
+  }
+
+  Serial.printf(
+    "Reflector listening on %s\n",
+    WiFi.localIP().toString().c_str());
+}
+
+void loop()
+{
+  // Print reflector statistics every 10 seconds
+  delay(10000);
+  Serial.printf(
+    "Reflected = %lu, Dropped = %lu\n",
+    pinger.GetReflectedRequests(),
+    pinger.GetDroppedRequests());
+}
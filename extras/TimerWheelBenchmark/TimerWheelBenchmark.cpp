@@ -0,0 +1,269 @@
+/*****************************************************************************
+Arduino library handling ping messages for the esp8266 platform
+
+MIT License
+
+Copyright (c) 2018 Alessio Leoncini
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*****************************************************************************/
+
+// Host benchmark and self check of PingerTimerWheel. Build and run with:
+//
+//   g++ -std=c++11 -O2 -I../../src -o TimerWheelBenchmark *.cpp ../../src/*Wheel.cpp
+//   ./TimerWheelBenchmark
+//
+// Exit status is nonzero if a timer expires at the wrong time.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "PingerTimerWheel.h"
+
+// Number of timers used by every test
+static const int TimersCount = 4096;
+
+static PingerTimerWheel Wheel;
+static PingerTimer Timers[TimersCount];
+
+// Expected expiry time of every timer, and whether it is scheduled
+static uint32_t ExpectedExpiry[TimersCount];
+static bool Scheduled[TimersCount];
+
+// Time reached by the running advance, which new delays count from
+static uint32_t Target = 0;
+
+// Counters updated by timer functions
+static uint32_t Errors = 0;
+static uint32_t Expired = 0;
+
+// Nanoseconds elapsed since specified time point
+static double ElapsedNs(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::nano>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+// Random delay, mostly short as echo timeouts, sometimes beyond wheel range
+static uint32_t RandomDelay()
+{
+  switch(rand() % 4)
+  {
+    case 0: return rand() % 64;
+    case 1: return rand() % 5000;
+    case 2: return rand() % 300000;
+    default: return (uint32_t)rand() % 40000000;
+  }
+}
+
+// Schedule timer and remember when it is expected to expire
+static void ScheduleChecked(int i, uint32_t delay)
+{
+  Wheel.Schedule(&Timers[i], delay);
+  ExpectedExpiry[i] = Target + delay;
+  Scheduled[i] = true;
+}
+
+// Timer function checking expiry time, then sometimes scheduling again
+static void CheckedExpiry(void * arg)
+{
+  int i = (int)(intptr_t)arg;
+
+  // Wheel time was already advanced past the expired tick
+  if(Scheduled[i] == false || ExpectedExpiry[i] != Wheel.GetTime() - 1)
+  {
+    ++Errors;
+  }
+  Scheduled[i] = false;
+  ++Expired;
+
+  if(rand() % 3 == 0)
+  {
+    ScheduleChecked(i, RandomDelay());
+  }
+}
+
+// Advance the wheel, keeping track of the time it reaches
+static void AdvanceChecked(uint32_t ticks)
+{
+  Target = Wheel.GetTime() + ticks;
+  Wheel.Advance(ticks);
+}
+
+// Timer function doing nothing
+static void EmptyExpiry(void *)
+{
+  ++Expired;
+}
+
+// Random schedule, cancel and advance operations, checking that every timer
+// expires exactly when expected and that the next expiry is never overrated
+static void SelfCheck()
+{
+  srand(1);
+  for(int i = 0; i < TimersCount; i++)
+  {
+    Timers[i].SetCallback(CheckedExpiry, (void *)(intptr_t)i);
+  }
+
+  for(long step = 0; step < 200000; step++)
+  {
+    int i = rand() % TimersCount;
+    int operation = rand() % 100;
+    if(operation < 3)
+    {
+      ScheduleChecked(i, RandomDelay());
+    }
+    else if(operation < 4)
+    {
+      Wheel.Cancel(&Timers[i]);
+      Scheduled[i] = false;
+    }
+    else
+    {
+      if(Wheel.GetPendingTimers() > 0)
+      {
+        uint32_t earliest = 0xffffffff;
+        for(int j = 0; j < TimersCount; j++)
+        {
+          uint32_t ticks = ExpectedExpiry[j] - Wheel.GetTime();
+          if(Scheduled[j] && ticks < earliest)
+          {
+            earliest = ticks;
+          }
+        }
+        if(Wheel.GetTicksToNextExpiry() > earliest)
+        {
+          ++Errors;
+        }
+      }
+      AdvanceChecked(1 + rand() % 2000);
+    }
+  }
+
+  // Drain every timer, far ones included
+  for(int i = 0; i < TimersCount; i++)
+  {
+    Timers[i].SetCallback(EmptyExpiry, nullptr);
+  }
+  Wheel.Advance(0xffffffff);
+
+  printf("Self check: %u expired, %u errors\n", Expired, Errors);
+}
+
+// Timer function rescheduling itself once, as echo requests restart their
+// timeout when the previous one expires
+static void RescheduleExpiry(void *)
+{
+  ++Expired;
+  if(Expired == 1)
+  {
+    ScheduleChecked(0, 100);
+  }
+  else if(ExpectedExpiry[0] != Wheel.GetTime() - 1)
+  {
+    ++Errors;
+  }
+}
+
+// Advance well past an expiry, as a late driving timer does, and check
+// that the timer scheduled again by the expired function is not early
+static void LateAdvanceCheck()
+{
+  Expired = 0;
+  Target = Wheel.GetTime();
+  Timers[0].SetCallback(RescheduleExpiry, nullptr);
+  Wheel.Schedule(&Timers[0], 10);
+  AdvanceChecked(25);
+  AdvanceChecked(100);
+  if(Expired != 1)
+  {
+    ++Errors;
+  }
+  AdvanceChecked(1);
+  if(Expired != 2)
+  {
+    ++Errors;
+  }
+
+  printf("Late advance check: %u errors\n", Errors);
+}
+
+int main()
+{
+  SelfCheck();
+  LateAdvanceCheck();
+  if(Errors != 0 || Wheel.GetPendingTimers() != 0)
+  {
+    return 1;
+  }
+
+  // Schedule and cancel cost
+  const int operations = 10000000;
+  auto start = std::chrono::steady_clock::now();
+  for(int k = 0; k < operations; k++)
+  {
+    Wheel.Schedule(&Timers[k % TimersCount], k % 1000);
+    Wheel.Cancel(&Timers[(k * 7) % TimersCount]);
+  }
+  printf("Schedule + cancel: %.1f ns\n", ElapsedNs(start) / operations);
+  for(int i = 0; i < TimersCount; i++)
+  {
+    Wheel.Cancel(&Timers[i]);
+  }
+
+  // Advance cost with many 1 second timeouts in flight, rescheduled as
+  // soon as they expire, as in continuous monitoring
+  for(int i = 0; i < TimersCount; i++)
+  {
+    Wheel.Schedule(&Timers[i], i % 1000);
+  }
+  Expired = 0;
+  const uint32_t ticks = 1000000;
+  start = std::chrono::steady_clock::now();
+  for(uint32_t t = 0; t < ticks; t++)
+  {
+    Wheel.Advance(1);
+    while(Expired > 0)
+    {
+      --Expired;
+      Wheel.Schedule(&Timers[rand() % TimersCount], 1000);
+    }
+  }
+  printf("Advance, %d timers: %.1f ns per tick\n",
+    TimersCount, ElapsedNs(start) / ticks);
+  for(int i = 0; i < TimersCount; i++)
+  {
+    Wheel.Cancel(&Timers[i]);
+  }
+
+  // Wake ups needed by a single 1 second timeout, when the driving timer is
+  // armed for the earliest possible expiry
+  uint32_t wakeUps = 0;
+  Expired = 0;
+  Wheel.Schedule(&Timers[0], 999);
+  while(Expired == 0)
+  {
+    Wheel.Advance(Wheel.GetTicksToNextExpiry() + 1);
+    ++wakeUps;
+  }
+  printf("Wake ups for a 1 s timeout: %u\n", wakeUps);
+
+  return 0;
+}
@@ -25,6 +25,7 @@ SOFTWARE.
 *****************************************************************************/
 
 #include <Esp.h>
+#include <math.h> // needed for sqrtf()
 #include "Pinger.h"
 #include "ESP8266WiFi.h" // needed for WiFi.hostByName()
 
@@ -33,8 +34,48 @@ extern "C"
   #include <lwip/icmp.h> // needed for icmp packet definitions
   #include <lwip/inet_chksum.h> // needed for inet_chksum()
   #include <lwip/sys.h> // needed for sys_now()
+  #include <lwip/ip.h> // needed for ip_current_dest_addr() and ip4_route()
+  #include <lwip/netif.h> // needed for netif
 }
 
+// Marker written by the reflector at the beginning of the echo payload,
+// followed by the receive and transmit timestamps in microseconds
+static const u32_t ReflectorTimestampMagic = 0x50524546; // "PREF"
+
+// Echo payload bytes needed to hold marker and timestamps
+static const u16_t ReflectorTimestampLen = 3 * sizeof(u32_t);
+
+// Gets the address of the interface LWIP routes packets to destination
+// through, or 0 if there is no route
+static u32_t RouteSourceAddress(const ip_addr_t * destination)
+{
+  struct netif * outputInterface = ip4_route(destination);
+  return outputInterface != nullptr ? outputInterface->ip_addr.addr : 0;
+}
+
+// Packet pair sequence numbers have the top bit set. Ping sequences wrap
+// at 0x7fff, so late pair responses never match a ping sequence
+static const u16_t PairSequenceFirst = 0x8000;
+
+// Timer wheel shared by all instances, with 1 millisecond ticks. A single
+// one-shot SDK timer advances it, armed for the earliest possible expiry
+static PingerTimerWheel TimerWheel;
+static os_timer_t TimerWheelTick;
+static bool TimerWheelArmed = false;
+
+// System time matching the wheel time, and system time when the armed SDK
+// timer fires
+static u32_t TimerWheelLastTick = 0;
+static u32_t TimerWheelDeadline = 0;
+
+// True while the wheel runs expired timers. Timers scheduled meanwhile are
+// taken into account when the SDK timer is armed after the advance
+static bool TimerWheelAdvancing = false;
+
+// Longest SDK timer delay used, in milliseconds. The wheel is simply
+// advanced and the SDK timer armed again when it expires
+static const u32_t TimerWheelMaxDelay = 3600000;
+
 //////////////////////////////////////////////////////////////////////////////
 // Constructor
 Pinger::Pinger()
@@ -48,19 +89,58 @@ Pinger::Pinger()
   // Empty user defined callback references
   m_onReceive = nullptr;
   m_onEnd = nullptr;
+  m_onStateChange = nullptr;
+  m_onBatchEnd = nullptr;
+  m_onBandwidthEnd = nullptr;
+
+  // No results array by default
+  m_results = nullptr;
+  m_resultsCapacity = 0;
 
   // Zero echo requests for now
   m_requestsToSend = 0;
+  m_sequenceInProgress = false;
+
+  // Reflector disabled by default
+  m_reflectorEnabled = false;
+  m_reflectorTimestamps = false;
+  m_reflectorMaxRate = 0;
+  m_reflectedRequests = 0;
+  m_droppedRequests = 0;
 
   // A valid size of an icmp echo request can be 40 bytes: 8 bytes for the 
   // icmp echo header and 32 data bytes.
   m_echoPayloadLen = 32;
+
+  // Default link quality evaluation: degraded above 200 ms or 20% loss,
+  // down above 50% loss. Latest probe weights 1/8 in the moving averages,
+  // so a single lost probe on a healthy link does not degrade it
+  m_degradedResponseTime = 200;
+  m_degradedLoss = 0.2f;
+  m_downLoss = 0.5f;
+  m_linkHysteresis = 0.1f;
+  m_linkSmoothing = 0.125f;
+  ResetLinkQuality();
+
+  // No packet capture by default
+  m_capture = nullptr;
+
+  // No bandwidth measurement running
+  m_bandwidthMode = false;
+
+  // Bind timers to their callbacks
+  m_requestTimeoutTimer.SetCallback(TimeoutCallback, (void *)this);
+  m_fakeTimer.SetCallback(ReceivedResponseCallback, (void *)this);
 }
 
 //////////////////////////////////////////////////////////////////////////////
 // Destructor
 Pinger::~Pinger()
 {
+  // Timers are linked in the shared timer wheel, so unlink them
+  CancelTimer(&m_requestTimeoutTimer);
+  CancelTimer(&m_fakeTimer);
+
   ClearPcb();
 }
 
@@ -78,38 +158,53 @@ void Pinger::OnEnd(PingerCallback callback)
   m_onEnd = callback;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Set callback to run when the link quality state changes
+void Pinger::OnStateChange(PingerCallback callback)
+{
+  m_onStateChange = callback;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Set callback to run when a bandwidth measurement ends
+void Pinger::OnBandwidthEnd(PingerBandwidthCallback callback)
+{
+  m_onBandwidthEnd = callback;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Set callback to run when a group of ping requests is run, receiving
+// all results at once
+void Pinger::OnBatchEnd(PingerBatchCallback callback)
+{
+  m_onBatchEnd = callback;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sets the array filled with one result per echo request during a ping
+// sequence
+void Pinger::SetResultBuffer(PingerProbeResult * results, u32_t capacity)
+{
+  m_results = results;
+  m_resultsCapacity = results != nullptr ? capacity : 0;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // Ping an IP address a number of times, with specified timeout.
 // Return false if an error occurs
 bool Pinger::Ping(IPAddress ip, u32_t requests, u32_t timeout)
 {
   // If zero packets to send or countdown not expired yet, exit
-  if(requests == 0 || m_requestsToSend != 0)
+  if(requests == 0 || m_requestsToSend != 0 || m_sequenceInProgress)
   {
     return false;
   }
 
   // If never assigned yet, create protocol control block data
   // and assign callback to execute when ICMP packet received
-  if(m_IcmpProtocolControlBlock == nullptr)
+  if(CreatePcb() == false)
   {
-    // Create new ICMP detection data
-    m_IcmpProtocolControlBlock = raw_new(IP_PROTO_ICMP);
-    if(m_IcmpProtocolControlBlock == nullptr)
-    {
-      return false;
-    }
-
-    // When LWIP detects a packet corresponding to specified protocol control
-    // block, the PingReceivedStatic callback is executed
-    raw_recv(
-      m_IcmpProtocolControlBlock,
-      PingReceivedStatic,
-      (void *)this);
-
-    // Selects the local interfaces where detection will be made.
-    // In this case, all local interfaces
-    raw_bind(m_IcmpProtocolControlBlock, IP_ADDR_ANY);
+    return false;
   }
 
   // Reset response
@@ -119,8 +214,15 @@ bool Pinger::Ping(IPAddress ip, u32_t requests, u32_t timeout)
   m_pingResponse.DestIPAddress = ip;
   m_pingResponse.EchoRequestTimeout = timeout;
 
+  // Link quality is carried over from previous sequences
+  m_pingResponse.SmoothedResponseTime = m_smoothedResponseTime;
+  m_pingResponse.SmoothedLoss = m_smoothedLoss;
+  m_pingResponse.LinkState = m_linkState;
+  m_pingResponse.PreviousLinkState = m_previousLinkState;
+
   // Assign initial values to present class members
   m_requestsToSend = requests;
+  m_sequenceInProgress = true;
   m_firstRequestTimestamp = sys_now();
 
   // Build icmp echo request and send it
@@ -151,6 +253,63 @@ bool Pinger::Ping(const String & hostname, u32_t requests, u32_t timeout)
   return pingSucceeded;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Estimate bottleneck and path capacity towards an IP address.
+// Return false if an error occurs
+bool Pinger::MeasureBandwidth(
+  IPAddress ip,
+  u16_t minPayload,
+  u16_t maxPayload,
+  u8_t sizes,
+  u8_t pairsPerSize,
+  u32_t timeout)
+{
+  // Check parameters. Payloads must fit an unfragmented IPv4 packet on
+  // ethernet, and the regression needs two sizes at least
+  if(minPayload >= maxPayload ||
+    maxPayload > 1472 ||
+    sizes < 2 ||
+    sizes > PingerBandwidthResponse::MaxSizes ||
+    pairsPerSize == 0 ||
+    (u32_t)sizes * pairsPerSize > PingerBandwidthResponse::MaxPairs)
+  {
+    return false;
+  }
+
+  // Exit if a ping sequence or measurement is running
+  if(m_requestsToSend != 0 || m_sequenceInProgress)
+  {
+    return false;
+  }
+
+  if(CreatePcb() == false)
+  {
+    return false;
+  }
+
+  // Reset response and spread payload lengths evenly
+  m_bandwidthResponse.Reset();
+  m_bandwidthResponse.DestIPAddress = ip;
+  m_bandwidthResponse.EchoRequestTimeout = timeout;
+  m_bandwidthResponse.Sizes = sizes;
+  for(u8_t i = 0; i < sizes; i++)
+  {
+    m_bandwidthResponse.PayloadLengths[i] = minPayload +
+      (u32_t)(maxPayload - minPayload) * i / (sizes - 1);
+  }
+
+  // Every request sends a pair of echo requests
+  m_requestsToSend = (u32_t)sizes * pairsPerSize;
+  m_pairIndex = 0;
+  m_pairSequenceNumber = PairSequenceFirst;
+  m_sequenceInProgress = true;
+  m_bandwidthMode = true;
+
+  SendPacketPair();
+
+  return true;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // Sets the ID of echo request packets. Useful to filter echo responses
 // when multiple istances of present class are used.
@@ -187,6 +346,105 @@ void Pinger::StopPingSequence()
   m_requestsToSend = 0;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Starts answering incoming echo requests directly from the raw PCB
+// receive callback, bypassing the LWIP icmp responder.
+// Return false if an error occurs
+bool Pinger::StartReflector(u32_t maxRequestsPerSecond, bool addTimestamps)
+{
+  // Echo requests are intercepted by the same protocol control block used
+  // to detect echo responses
+  if(CreatePcb() == false)
+  {
+    return false;
+  }
+
+  // Forget sources tracked by a previous reflector session
+  memset(m_reflectorSources, 0, sizeof(m_reflectorSources));
+
+  m_reflectorMaxRate = maxRequestsPerSecond;
+  m_reflectorTimestamps = addTimestamps;
+  m_reflectedRequests = 0;
+  m_droppedRequests = 0;
+  m_reflectorEnabled = true;
+
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Stops answering incoming echo requests
+void Pinger::StopReflector()
+{
+  m_reflectorEnabled = false;
+
+  // Keep the protocol control block if a ping sequence still needs it
+  if(m_sequenceInProgress == false)
+  {
+    ClearPcb();
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gets the number of echo requests answered in reflector mode
+u32_t Pinger::GetReflectedRequests()
+{
+  return m_reflectedRequests;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gets the number of echo requests dropped by the reflector rate limit
+u32_t Pinger::GetDroppedRequests()
+{
+  return m_droppedRequests;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sets thresholds used to evaluate link quality
+void Pinger::SetLinkQualityThresholds(
+  u32_t degradedResponseTime,
+  float degradedLoss,
+  float downLoss,
+  float hysteresis)
+{
+  m_degradedResponseTime = degradedResponseTime;
+  m_degradedLoss = degradedLoss;
+  m_downLoss = downLoss;
+  m_linkHysteresis = hysteresis;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sets the weight of the latest probe in the moving averages, from 0 to 1
+void Pinger::SetLinkQualitySmoothing(float weight)
+{
+  m_linkSmoothing = weight;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gets current link quality state
+PingerLinkState Pinger::GetLinkState()
+{
+  return m_linkState;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Forgets link quality history, restarting from the unknown state
+void Pinger::ResetLinkQuality()
+{
+  m_linkState = PingerLinkState::Unknown;
+  m_previousLinkState = PingerLinkState::Unknown;
+  m_smoothedResponseTime = 0.f;
+  m_smoothedLoss = 0.f;
+  m_responseTimeSampled = false;
+  m_stateChangePending = false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sets the capture ring where sent and received icmp packets are recorded
+void Pinger::SetCapture(PingerCapture * capture)
+{
+  m_capture = capture;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // LWIP callback run when a ping response is received (static wrapper)
 u8_t Pinger::PingReceivedStatic(
@@ -214,6 +472,9 @@ u8_t Pinger::PingReceivedStatic(
 // LWIP callback run when a ping response is received
 u8_t Pinger::PingReceived(pbuf * packetBuffer, const ip_addr_t * addr)
 {
+  // Take the receive timestamp as early as possible
+  u32_t receiveTimestamp = system_get_time();
+
   // Check parameters
   if(packetBuffer == nullptr || addr == nullptr)
   {
@@ -230,6 +491,15 @@ u8_t Pinger::PingReceived(pbuf * packetBuffer, const ip_addr_t * addr)
     // further PCBs and/or forwarded to other protocol layers.
     return 0;
   }
+
+  // The icmp header is looked for just after a 20 bytes IPv4 header. In
+  // reflector mode, packets carrying IP options are left to the LWIP icmp
+  // responder, otherwise options would be echoed back as icmp bytes
+  if(m_reflectorEnabled && IPH_HL(ip) != 5)
+  {
+    return 0;
+  }
+
   
   // Move the ->payload pointer skipping the IPv4 header of the packet with 
   // pbuf_header function. If such function fails, it returns nonzero
@@ -252,7 +522,21 @@ u8_t Pinger::PingReceived(pbuf * packetBuffer, const ip_addr_t * addr)
     // further PCBs and/or forwarded to other protocol layers.
     return 0;
   }
+
+  // In reflector mode, answer echo requests here
+  if (m_reflectorEnabled && echoResponseHeader->type == ICMP_ECHO)
+  {
+    return ReflectEchoRequest(packetBuffer, addr, receiveTimestamp);
+  }
   
+  // In bandwidth mode, responses are matched against the current pair
+  if (m_bandwidthMode &&
+    echoResponseHeader->type == ICMP_ER &&
+    echoResponseHeader->id == m_packetId)
+  {
+    return PacketPairReceived(packetBuffer, receiveTimestamp);
+  }
+
   // Check echo response header validity
   if ((echoResponseHeader->id != m_packetId) ||
       (echoResponseHeader->seqno != htons(m_pingResponse.SequenceNumber)) ||
@@ -266,7 +550,8 @@ u8_t Pinger::PingReceived(pbuf * packetBuffer, const ip_addr_t * addr)
     return 0;
   }
 
-  // Packet is valid, so read data from echo response
+  // Packet is valid, so record it and read data from echo response
+  CaptureReceived(packetBuffer);
   
   // Set flags and counters
   m_pingResponse.ReceivedResponse = true;
@@ -281,6 +566,33 @@ u8_t Pinger::PingReceived(pbuf * packetBuffer, const ip_addr_t * addr)
 
   // Current response time
   m_pingResponse.ResponseTime = sys_now() - m_requestTimestamp;
+
+  // Record result of current request
+  PingerProbeResult * result = CurrentResult();
+  if(result != nullptr)
+  {
+    result->Status = PingerProbeStatus::Received;
+    result->TimeToLive = ip->_ttl;
+    result->ResponseTime = m_pingResponse.ResponseTime;
+  }
+
+  // If the remote host is a reflector with timestamps enabled, read the
+  // time it spent to answer
+  m_pingResponse.RemoteProcessingTime = 0;
+  if(packetBuffer->len >= sizeof(struct icmp_echo_hdr) + ReflectorTimestampLen)
+  {
+    // Payload is not 32 bit aligned, so copy it before reading
+    u32_t stamps[3];
+    memcpy(
+      stamps,
+      (u8_t *)echoResponseHeader + sizeof(struct icmp_echo_hdr),
+      ReflectorTimestampLen);
+    if(ntohl(stamps[0]) == ReflectorTimestampMagic)
+    {
+      m_pingResponse.RemoteProcessingTime =
+        ntohl(stamps[2]) - ntohl(stamps[1]);
+    }
+  }
   
   // Maximum response time
   if(m_pingResponse.ResponseTime > m_pingResponse.MaxResponseTime)
@@ -301,17 +613,19 @@ u8_t Pinger::PingReceived(pbuf * packetBuffer, const ip_addr_t * addr)
     m_pingResponse.AvgResponseTime /= m_pingResponse.TotalReceivedResponses;
   }
 
+  // Update link quality with current response
+  if(UpdateLinkQuality(true, m_pingResponse.ResponseTime))
+  {
+    m_stateChangePending = true;
+  }
+
   // If user defined a onReceive event, call such callback with the help of 
   // the ESP8266 timer with a 1 ms timeout. This trick allows to call the event
-  // callback asynchronously
-  if (m_onReceive != nullptr)
+  // callback asynchronously. The same holds for the onStateChange event
+  if (m_onReceive != nullptr ||
+    (m_stateChangePending && m_onStateChange != nullptr))
   {
-    os_timer_disarm(&m_fakeTimer);
-    os_timer_setfn(
-      &m_fakeTimer,
-      (os_timer_func_t *)ReceivedResponseCallback,
-      (void *)this);
-    os_timer_arm(&m_fakeTimer, 1, 0);
+    ScheduleTimer(&m_fakeTimer, 1);
   }
 
   // Eat the packet by calling pbuf_free() and returning non-zero.
@@ -320,6 +634,418 @@ u8_t Pinger::PingReceived(pbuf * packetBuffer, const ip_addr_t * addr)
   return 1;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Record reception of an echo response belonging to a packet pair.
+// The ->payload pointer must point to the icmp echo header
+u8_t Pinger::PacketPairReceived(pbuf * packetBuffer, u32_t receiveTimestamp)
+{
+  struct icmp_echo_hdr * echoResponseHeader =
+    (struct icmp_echo_hdr *)packetBuffer->payload;
+  CaptureReceived(packetBuffer);
+
+  // Responses to previous pairs, arrived after their timeout, are ignored
+  u16_t pairPosition = ntohs(echoResponseHeader->seqno) - m_pairSequenceNumber;
+  if(pairPosition < 2 && m_pairReceived[pairPosition] == false)
+  {
+    m_pairReceived[pairPosition] = true;
+    m_pairReceiveTimestamp[pairPosition] = receiveTimestamp;
+    ++(m_bandwidthResponse.TotalReceivedResponses);
+
+    // When the pair is complete, go on without waiting for timeout. The
+    // pair is accounted out of LWIP callback context
+    if(m_pairReceived[0] && m_pairReceived[1])
+    {
+      ScheduleTimer(&m_requestTimeoutTimer, 1);
+    }
+  }
+
+  // Eat the packet by calling pbuf_free() and returning non-zero.
+  pbuf_free(packetBuffer);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Account results of the current packet pair, then send the next pair
+// or end the bandwidth measurement
+void Pinger::PacketPairCompleted()
+{
+  CancelTimer(&m_requestTimeoutTimer);
+
+  PingerBandwidthResponse & response = m_bandwidthResponse;
+  u8_t size = m_pairIndex % response.Sizes;
+
+  // The first request of the pair finds the path idle, so its response time
+  // is a size sample. The minimum over several pairs filters queuing delay
+  if(m_pairReceived[0])
+  {
+    u32_t responseTime = m_pairReceiveTimestamp[0] - m_pairSendTimestamp[0];
+    if(responseTime < response.MinResponseTimes[size])
+    {
+      response.MinResponseTimes[size] = responseTime;
+    }
+  }
+
+  // The second response is spaced from the first one by the time needed
+  // to serialize a packet on the bottleneck link
+  if(m_pairReceived[0] && m_pairReceived[1])
+  {
+    u32_t dispersion = m_pairReceiveTimestamp[1] - m_pairReceiveTimestamp[0];
+    if(dispersion > 0 && dispersion < 0x80000000)
+    {
+      u32_t packetBits = 8 * (response.PayloadLengths[size] +
+        sizeof(struct icmp_echo_hdr) + PBUF_IP_HLEN);
+      response.PacketPairEstimates[response.PacketPairSamples] =
+        packetBits * 1000000.f / dispersion;
+      ++(response.PacketPairSamples);
+    }
+  }
+
+  ++m_pairIndex;
+
+  if(m_requestsToSend != 0)
+  {
+    SendPacketPair();
+    return;
+  }
+
+  // Measurement ended
+  EvaluateBandwidth();
+  m_bandwidthMode = false;
+  m_sequenceInProgress = false;
+  if(m_onBandwidthEnd != nullptr)
+  {
+    m_onBandwidthEnd(m_bandwidthResponse);
+  }
+
+  // Clear protocol control block, unless still needed by the reflector
+  // or by a sequence started from the callback
+  if(m_reflectorEnabled == false && m_sequenceInProgress == false)
+  {
+    ClearPcb();
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Send a pair of back-to-back echo requests
+void Pinger::SendPacketPair()
+{
+  u16_t payloadLength = m_bandwidthResponse.PayloadLengths[
+    m_pairIndex % m_bandwidthResponse.Sizes];
+
+  // Pairs use two consecutive sequence numbers, in their own range
+  m_pairSequenceNumber += 2;
+  if(m_pairSequenceNumber >= 0xfffe)
+  {
+    m_pairSequenceNumber = PairSequenceFirst;
+  }
+
+  // Build both requests before sending, so that they leave back-to-back.
+  // Any delay between them would bound the dispersion measured on replies
+  struct pbuf * packetBuffers[2];
+  for(u8_t i = 0; i < 2; i++)
+  {
+    m_pairReceived[i] = false;
+    packetBuffers[i] = BuildEchoRequest(m_pairSequenceNumber + i, payloadLength);
+  }
+
+  // Send the pair only if both requests were built, otherwise the pair is
+  // accounted as lost when timeout expires
+  ip_addr_t destIPAddress;
+  destIPAddress.addr = m_bandwidthResponse.DestIPAddress;
+  if(packetBuffers[0] != nullptr && packetBuffers[1] != nullptr)
+  {
+    // Record the pair before sending, since LWIP prepends its headers to
+    // the packet buffers and leaves them there
+    if(m_capture != nullptr)
+    {
+      u32_t source = RouteSourceAddress(&destIPAddress);
+      for(u8_t i = 0; i < 2; i++)
+      {
+        m_capture->CaptureOutgoing(
+          packetBuffers[i],
+          source,
+          destIPAddress.addr,
+          m_IcmpProtocolControlBlock->ttl);
+      }
+    }
+
+    raw_sendto(m_IcmpProtocolControlBlock, packetBuffers[0], &destIPAddress);
+    m_pairSendTimestamp[0] = system_get_time();
+    raw_sendto(m_IcmpProtocolControlBlock, packetBuffers[1], &destIPAddress);
+    m_pairSendTimestamp[1] = system_get_time();
+    m_bandwidthResponse.TotalSentRequests += 2;
+  }
+
+  // Free packet buffers memory
+  for(u8_t i = 0; i < 2; i++)
+  {
+    if(packetBuffers[i] != nullptr)
+    {
+      pbuf_free(packetBuffers[i]);
+    }
+  }
+
+  --m_requestsToSend;
+
+  // Start countdown for waiting responses
+  ScheduleTimer(&m_requestTimeoutTimer, m_bandwidthResponse.EchoRequestTimeout);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Evaluate capacity estimates from collected samples
+void Pinger::EvaluateBandwidth()
+{
+  PingerBandwidthResponse & response = m_bandwidthResponse;
+
+  // Bottleneck capacity is the median of packet pair estimates, while
+  // its spread is the median absolute deviation
+  u8_t samples = response.PacketPairSamples;
+  if(samples > 0)
+  {
+    float sorted[PingerBandwidthResponse::MaxPairs];
+    for(u8_t i = 0; i < samples; i++)
+    {
+      // Insertion sort, samples are few
+      float value = response.PacketPairEstimates[i];
+      u8_t j = i;
+      for(; j > 0 && sorted[j - 1] > value; j--)
+      {
+        sorted[j] = sorted[j - 1];
+      }
+      sorted[j] = value;
+    }
+    float median = sorted[samples / 2];
+
+    for(u8_t i = 0; i < samples; i++)
+    {
+      float deviation = response.PacketPairEstimates[i] - median;
+      float value = deviation < 0 ? -deviation : deviation;
+      u8_t j = i;
+      for(; j > 0 && sorted[j - 1] > value; j--)
+      {
+        sorted[j] = sorted[j - 1];
+      }
+      sorted[j] = value;
+    }
+
+    response.PacketPairCapacity = median;
+    response.PacketPairDeviation = sorted[samples / 2] / median;
+  }
+
+  // Linear regression of minimum response time over packet size. The slope
+  // is the round trip serialization delay per byte, summed over every
+  // store and forward hop of the path
+  float count = 0.f;
+  float sumX = 0.f;
+  float sumY = 0.f;
+  for(u8_t i = 0; i < response.Sizes; i++)
+  {
+    if(response.MinResponseTimes[i] != 0xffffffff)
+    {
+      count += 1.f;
+      sumX += response.PayloadLengths[i];
+      sumY += response.MinResponseTimes[i];
+    }
+  }
+  if(count < 2.f)
+  {
+    return;
+  }
+
+  float meanX = sumX / count;
+  float meanY = sumY / count;
+  float sxx = 0.f;
+  float sxy = 0.f;
+  float syy = 0.f;
+  for(u8_t i = 0; i < response.Sizes; i++)
+  {
+    if(response.MinResponseTimes[i] != 0xffffffff)
+    {
+      float dx = response.PayloadLengths[i] - meanX;
+      float dy = response.MinResponseTimes[i] - meanY;
+      sxx += dx * dx;
+      sxy += dx * dy;
+      syy += dy * dy;
+    }
+  }
+  if(sxx <= 0.f)
+  {
+    return;
+  }
+
+  float slope = sxy / sxx;
+  float residuals = syy - slope * sxy;
+  if(residuals < 0.f)
+  {
+    residuals = 0.f;
+  }
+
+  // Intercept is moved from payload length to total packet length
+  float headersLength = sizeof(struct icmp_echo_hdr) + PBUF_IP_HLEN;
+  response.BaseResponseTime = meanY - slope * (meanX + headersLength);
+  response.SerializationDelay = slope / 2.f;
+  response.FitQuality = syy > 0.f ? 1.f - residuals / syy : 0.f;
+  if(count > 2.f)
+  {
+    response.SerializationDelayError =
+      sqrtf(residuals / (count - 2.f) / sxx) / 2.f;
+  }
+  if(response.SerializationDelay > 0.f)
+  {
+    response.PathCapacity = 8000000.f / response.SerializationDelay;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Answer an echo request in place, reusing the received packet buffer.
+// The ->payload pointer must point to the icmp echo header
+u8_t Pinger::ReflectEchoRequest(
+  pbuf * packetBuffer,
+  const ip_addr_t * addr,
+  u32_t receiveTimestamp)
+{
+  // Leave broadcast and multicast requests to the LWIP icmp responder
+  if(ip_addr_ismulticast(ip_current_dest_addr()) ||
+    ip_addr_isbroadcast(ip_current_dest_addr(), ip_current_netif()))
+  {
+    // Restore original position of ->payload pointer
+    pbuf_header(packetBuffer, PBUF_IP_HLEN);
+    return 0;
+  }
+
+  // Leave corrupted requests to the LWIP icmp responder, which drops them.
+  // Otherwise they would be answered with a valid checksum
+  if(inet_chksum_pbuf(packetBuffer) != 0)
+  {
+    // Restore original position of ->payload pointer
+    pbuf_header(packetBuffer, PBUF_IP_HLEN);
+    return 0;
+  }
+
+  // From here on the request is consumed by present instance
+  CaptureReceived(packetBuffer);
+
+  // Drop requests exceeding the rate limit. The packet is eaten, otherwise
+  // the LWIP icmp responder would answer it anyway
+  if(ReflectorRateAllowed(addr) == false)
+  {
+    ++m_droppedRequests;
+    pbuf_free(packetBuffer);
+    return 1;
+  }
+
+  // Turn the echo request into an echo response
+  struct icmp_echo_hdr * echoHeader =
+    (struct icmp_echo_hdr *)packetBuffer->payload;
+  ICMPH_TYPE_SET(echoHeader, ICMP_ER);
+
+  // If requested and if the payload is long enough, write timestamps and
+  // evaluate the whole checksum again. Otherwise only the type field 
+  // changed, so the checksum can be adjusted incrementally
+  if(m_reflectorTimestamps &&
+    packetBuffer->len >= sizeof(struct icmp_echo_hdr) + ReflectorTimestampLen)
+  {
+    // Payload is not 32 bit aligned, so stamps are copied into it
+    u32_t stamps[3];
+    stamps[0] = htonl(ReflectorTimestampMagic);
+    stamps[1] = htonl(receiveTimestamp);
+    stamps[2] = htonl(system_get_time());
+    memcpy(
+      (u8_t *)echoHeader + sizeof(struct icmp_echo_hdr),
+      stamps,
+      ReflectorTimestampLen);
+    echoHeader->chksum = 0;
+    echoHeader->chksum = inet_chksum_pbuf(packetBuffer);
+  }
+  else if(echoHeader->chksum > PP_HTONS(0xffffU - (ICMP_ECHO << 8)))
+  {
+    echoHeader->chksum += PP_HTONS(ICMP_ECHO << 8) + 1;
+  }
+  else
+  {
+    echoHeader->chksum += PP_HTONS(ICMP_ECHO << 8);
+  }
+
+  if(m_capture != nullptr)
+  {
+    // The response leaves from the address the request was sent to
+    m_capture->CaptureOutgoing(
+      packetBuffer,
+      ip_current_dest_addr()->addr,
+      addr->addr,
+      m_IcmpProtocolControlBlock->ttl);
+  }
+
+  // Send the response back to the requester. LWIP prepends the IPv4 header
+  // in the space left by the received one
+  raw_sendto(m_IcmpProtocolControlBlock, packetBuffer, addr);
+  ++m_reflectedRequests;
+
+  // Eat the packet, so that the LWIP icmp responder does not answer again
+  pbuf_free(packetBuffer);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Return true if an echo request from the specified source can be
+// answered without exceeding the reflector rate limit
+bool Pinger::ReflectorRateAllowed(const ip_addr_t * addr)
+{
+  if(m_reflectorMaxRate == 0)
+  {
+    return true;
+  }
+
+  u32_t now = sys_now();
+
+  // Look for the source, otherwise reuse the least recently started window
+  ReflectorSource * source = &m_reflectorSources[0];
+  for(u8_t i = 0; i < ReflectorSourcesCount; i++)
+  {
+    if(m_reflectorSources[i].Address == addr->addr)
+    {
+      source = &m_reflectorSources[i];
+      break;
+    }
+    if(m_reflectorSources[i].WindowStart < source->WindowStart)
+    {
+      source = &m_reflectorSources[i];
+    }
+  }
+
+  // Start a new one second window if source is new or window expired
+  if(source->Address != addr->addr || now - source->WindowStart >= 1000)
+  {
+    source->Address = addr->addr;
+    source->WindowStart = now;
+    source->Requests = 0;
+  }
+
+  if(source->Requests >= m_reflectorMaxRate)
+  {
+    return false;
+  }
+
+  ++(source->Requests);
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Record a received packet consumed by present instance.
+// The ->payload pointer must point to the icmp header
+void Pinger::CaptureReceived(pbuf * packetBuffer)
+{
+  if(m_capture == nullptr)
+  {
+    return;
+  }
+
+  // Capture starts from the IPv4 header
+  pbuf_header(packetBuffer, PBUF_IP_HLEN);
+  m_capture->CaptureIncoming(packetBuffer);
+  pbuf_header(packetBuffer, -PBUF_IP_HLEN);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // Timer callback run when an Echo request timeout event occurs (static wrapper)
 void Pinger::TimeoutCallback(void * pinger)
@@ -331,13 +1057,28 @@ void Pinger::TimeoutCallback(void * pinger)
 // Timer callback run when an Echo request timeout event occurs
 void Pinger::RequestTimeoutOccurred()
 {
+  // Bandwidth measurement pairs are accounted separately
+  if(m_bandwidthMode)
+  {
+    PacketPairCompleted();
+    return;
+  }
+
   // Disarm request timeout timer
-  os_timer_disarm(&m_requestTimeoutTimer);
+  CancelTimer(&m_requestTimeoutTimer);
 
   // If timeout expired without receiving any response, call onReceive event 
   // callback
   if(m_pingResponse.ReceivedResponse == false)
   {
+    PingerProbeResult * result = CurrentResult();
+    if(result != nullptr)
+    {
+      result->Status = PingerProbeStatus::Timeout;
+    }
+
+    bool stateChanged = UpdateLinkQuality(false, 0);
+
     if(m_onReceive != nullptr)
     {
       bool result = m_onReceive(m_pingResponse);
@@ -348,6 +1089,12 @@ void Pinger::RequestTimeoutOccurred()
         StopPingSequence();
       }
     }
+
+    // Timer context already, so the state change is notified directly
+    if(stateChanged)
+    {
+      NotifyStateChange();
+    }
   }
   
   if(m_requestsToSend != 0)
@@ -372,14 +1119,30 @@ void Pinger::RequestTimeoutOccurred()
       m_pingResponse.AvgResponseTime /= m_pingResponse.TotalReceivedResponses;
     }
 
+    // Count recorded results before any user callback, since callbacks
+    // may start a new ping sequence overwriting them
+    u32_t results = m_pingResponse.TotalSentRequests < m_resultsCapacity ?
+      m_pingResponse.TotalSentRequests : m_resultsCapacity;
+    m_sequenceInProgress = false;
+
+    // Hand all recorded results back at once
+    if(m_onBatchEnd != nullptr)
+    {
+      m_onBatchEnd(m_results, results);
+    }
+
     // Call the end ping requests callback if defined
     if(m_onEnd != nullptr)
     {
       m_onEnd(m_pingResponse);
     }
 
-    // Clear protocol control block
-    ClearPcb();
+    // Clear protocol control block, unless still needed by the reflector
+    // or by a sequence started from callbacks
+    if(m_reflectorEnabled == false && m_sequenceInProgress == false)
+    {
+      ClearPcb();
+    }
   }
 }
 
@@ -388,7 +1151,7 @@ void Pinger::RequestTimeoutOccurred()
 void Pinger::ReceivedResponseCallback(void * pinger)
 {
   Pinger &host = *(Pinger *)pinger;
-  os_timer_disarm(&host.m_fakeTimer);
+  CancelTimer(&host.m_fakeTimer);
   if (host.m_onReceive != nullptr)
   {
     bool result = host.m_onReceive(host.m_pingResponse);
@@ -399,6 +1162,91 @@ void Pinger::ReceivedResponseCallback(void * pinger)
       host.StopPingSequence();
     }
   }
+
+  if (host.m_stateChangePending)
+  {
+    host.NotifyStateChange();
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Update link quality moving averages with a probe result, and evaluate
+// link state. Return true if link state changed
+bool Pinger::UpdateLinkQuality(bool received, u32_t responseTime)
+{
+  // Update moving averages. The first response initializes the response
+  // time average, to avoid a slow ramp up from zero
+  float lossSample = received ? 0.f : 1.f;
+  m_smoothedLoss += m_linkSmoothing * (lossSample - m_smoothedLoss);
+  if(received)
+  {
+    if(m_responseTimeSampled == false)
+    {
+      m_smoothedResponseTime = responseTime;
+      m_responseTimeSampled = true;
+    }
+    else
+    {
+      m_smoothedResponseTime +=
+        m_linkSmoothing * (responseTime - m_smoothedResponseTime);
+    }
+  }
+
+  // Thresholds are lowered by the hysteresis fraction when the link is
+  // already in the state they lead to, so that small oscillations around
+  // a threshold do not cause repeated transitions
+  float exitFactor = 1.f - m_linkHysteresis;
+  float downLoss = m_linkState == PingerLinkState::Down ?
+    m_downLoss * exitFactor : m_downLoss;
+  bool degradedOrWorse = m_linkState >= PingerLinkState::Degraded;
+  float degradedLoss = degradedOrWorse ?
+    m_degradedLoss * exitFactor : m_degradedLoss;
+  float degradedResponseTime = degradedOrWorse ?
+    m_degradedResponseTime * exitFactor : m_degradedResponseTime;
+
+  // Evaluate new state
+  PingerLinkState newState = PingerLinkState::Healthy;
+  if(m_smoothedLoss >= downLoss)
+  {
+    newState = PingerLinkState::Down;
+  }
+  else if(m_smoothedLoss >= degradedLoss ||
+    m_smoothedResponseTime >= degradedResponseTime)
+  {
+    newState = PingerLinkState::Degraded;
+  }
+
+  bool stateChanged = newState != m_linkState;
+  if(stateChanged)
+  {
+    m_previousLinkState = m_linkState;
+    m_linkState = newState;
+  }
+
+  // Expose link quality to user defined callbacks
+  m_pingResponse.SmoothedResponseTime = m_smoothedResponseTime;
+  m_pingResponse.SmoothedLoss = m_smoothedLoss;
+  m_pingResponse.LinkState = m_linkState;
+  m_pingResponse.PreviousLinkState = m_previousLinkState;
+
+  return stateChanged;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Call the user defined OnStateChange callback
+void Pinger::NotifyStateChange()
+{
+  m_stateChangePending = false;
+  if(m_onStateChange != nullptr)
+  {
+    bool result = m_onStateChange(m_pingResponse);
+
+    // If event returned false, stop ping sequence
+    if(result == false)
+    {
+      StopPingSequence();
+    }
+  }
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -409,16 +1257,74 @@ void Pinger::BuildAndSendPacket()
   m_pingResponse.ReceivedResponse = false;
   m_pingResponse.EchoMessageSize = m_echoPayloadLen + 
     sizeof(struct icmp_echo_hdr);
+
+  ++(m_pingResponse.SequenceNumber);
+  if (m_pingResponse.SequenceNumber == 0x7fff)
+  {
+    m_pingResponse.SequenceNumber = 0;
+  }
+
+  // Build the packet
+  struct pbuf * packetBuffer = BuildEchoRequest(
+    m_pingResponse.SequenceNumber,
+    m_echoPayloadLen);
+  if(packetBuffer == nullptr)
+  {
+    return;
+  }
+
+  // Finally, send the packet and register timestamp
+  ip_addr_t destIPAddress;
+  destIPAddress.addr = m_pingResponse.DestIPAddress;
+  if(m_capture != nullptr)
+  {
+    m_capture->CaptureOutgoing(
+      packetBuffer,
+      RouteSourceAddress(&destIPAddress),
+      destIPAddress.addr,
+      m_IcmpProtocolControlBlock->ttl);
+  }
+  raw_sendto(m_IcmpProtocolControlBlock, packetBuffer, &destIPAddress);
+  m_requestTimestamp = sys_now();
+  
+  // Free packet buffer memory
+  pbuf_free(packetBuffer);
+  
+  // Update counters
+  ++(m_pingResponse.TotalSentRequests);
+  --m_requestsToSend;
+
+  // Prepare result of current request
+  PingerProbeResult * result = CurrentResult();
+  if(result != nullptr)
+  {
+    result->SequenceNumber = m_pingResponse.SequenceNumber;
+    result->TimeToLive = 0;
+    result->Status = PingerProbeStatus::Pending;
+    result->ResponseTime = 0;
+  }
   
+  // Start countdown for waiting response
+  ScheduleTimer(&m_requestTimeoutTimer, m_pingResponse.EchoRequestTimeout);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Compose an echo request with specified sequence number and payload
+// length. Return the packet buffer, to be freed by the caller, or nullptr
+// if an error occurs
+struct pbuf * Pinger::BuildEchoRequest(u16_t sequenceNumber, u16_t payloadLength)
+{
+  u16_t echoMessageSize = payloadLength + sizeof(struct icmp_echo_hdr);
+
   // Allocate packet buffer structure. Buffer memory is allocated as one 
   // large chunk. This includes protocol headers as well.
   struct pbuf * packetBuffer = pbuf_alloc(
     PBUF_IP,
-    m_pingResponse.EchoMessageSize,
+    echoMessageSize,
     PBUF_RAM);
   if(packetBuffer == nullptr)
   {
-    return;
+    return nullptr;
   }
   
   // Check if packet buffer correctly created
@@ -427,7 +1333,7 @@ void Pinger::BuildAndSendPacket()
   {
     // Free packet buffer memory and exit
     pbuf_free(packetBuffer);
-    return;
+    return nullptr;
   }
 
   // Build echo request packet
@@ -437,15 +1343,10 @@ void Pinger::BuildAndSendPacket()
   ICMPH_CODE_SET(echoRequestHeader, 0);
   echoRequestHeader->chksum = 0;
   echoRequestHeader->id = m_packetId;
-  ++(m_pingResponse.SequenceNumber);
-  if (m_pingResponse.SequenceNumber == 0x7fff)
-  {
-    m_pingResponse.SequenceNumber = 0;
-  }
-  echoRequestHeader->seqno = htons(m_pingResponse.SequenceNumber);
+  echoRequestHeader->seqno = htons(sequenceNumber);
 
   size_t icmpHeaderLen = sizeof(struct icmp_echo_hdr);
-  size_t icmpDataLen = m_pingResponse.EchoMessageSize - icmpHeaderLen;
+  size_t icmpDataLen = payloadLength;
 
   // Just after icmp echo request header, append payload bytes to reach
   // the specified packed dimension
@@ -462,28 +1363,150 @@ void Pinger::BuildAndSendPacket()
 
   // Evaluate and set packet checksum
   echoRequestHeader->chksum = inet_chksum(echoRequestHeader,
-    m_pingResponse.EchoMessageSize);
+    echoMessageSize);
 
-  // Finally, send the packet and register timestamp
-  ip_addr_t destIPAddress;
-  destIPAddress.addr = m_pingResponse.DestIPAddress;
-  raw_sendto(m_IcmpProtocolControlBlock, packetBuffer, &destIPAddress);
-  m_requestTimestamp = sys_now();
-  
-  // Free packet buffer memory
-  pbuf_free(packetBuffer);
-  
-  // Update counters
-  ++(m_pingResponse.TotalSentRequests);
-  --m_requestsToSend;
-  
-  // Start countdown for waiting response
-  os_timer_disarm(&m_requestTimeoutTimer);
+  return packetBuffer;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Schedule timer on the timer wheel shared by all instances, to expire
+// after the specified number of milliseconds
+void Pinger::ScheduleTimer(PingerTimer * timer, u32_t delay)
+{
+  // The wheel time is not advanced while idle, so time spent idle is
+  // simply skipped. While advancing, the wheel already counts delays from
+  // TimerWheelLastTick, so lag is zero
+  u32_t now = sys_now();
+  if(TimerWheel.GetPendingTimers() == 0)
+  {
+    TimerWheelLastTick = now;
+  }
+
+  // The wheel runs a timer scheduled with delay n when the (n+1)-th tick
+  // is processed, so remove one tick. Also add the ticks elapsed since the
+  // wheel was last advanced
+  u32_t lag = now - TimerWheelLastTick;
+  TimerWheel.Schedule(timer, lag + (delay > 0 ? delay - 1 : 0));
+
+  ArmTimerWheel();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Cancel timer scheduled on the shared timer wheel
+void Pinger::CancelTimer(PingerTimer * timer)
+{
+  TimerWheel.Cancel(timer);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Arm the SDK timer for the earliest possible expiry on the shared timer
+// wheel, unless already armed to fire earlier
+void Pinger::ArmTimerWheel()
+{
+  // The wheel is behind TimerWheelLastTick while advancing, so its next
+  // expiry would be underrated. The callback arms the timer at the end
+  if(TimerWheelAdvancing)
+  {
+    return;
+  }
+
+  if(TimerWheel.GetPendingTimers() == 0)
+  {
+    os_timer_disarm(&TimerWheelTick);
+    TimerWheelArmed = false;
+    return;
+  }
+
+  // The earliest expiry is processed once its tick has fully elapsed
+  u32_t ticks = TimerWheel.GetTicksToNextExpiry();
+  if(ticks >= TimerWheelMaxDelay)
+  {
+    ticks = TimerWheelMaxDelay - 1;
+  }
+  u32_t deadline = TimerWheelLastTick + ticks + 1;
+  if(TimerWheelArmed && (s32_t)(TimerWheelDeadline - deadline) <= 0)
+  {
+    return;
+  }
+
+  u32_t now = sys_now();
+  s32_t delay = (s32_t)(deadline - now);
+  if(delay < 1)
+  {
+    delay = 1;
+  }
+
+  os_timer_disarm(&TimerWheelTick);
   os_timer_setfn(
-    &m_requestTimeoutTimer,
-    (os_timer_func_t *)TimeoutCallback,
+    &TimerWheelTick,
+    (os_timer_func_t *)TimerWheelCallback,
+    nullptr);
+  os_timer_arm(&TimerWheelTick, delay, 0);
+  TimerWheelArmed = true;
+  TimerWheelDeadline = now + delay;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// SDK timer callback advancing the shared timer wheel
+void Pinger::TimerWheelCallback(void *)
+{
+  TimerWheelArmed = false;
+
+  // The SDK timer can be late, so advance by the elapsed time
+  u32_t now = sys_now();
+  u32_t elapsed = now - TimerWheelLastTick;
+  TimerWheelLastTick = now;
+  TimerWheelAdvancing = true;
+  TimerWheel.Advance(elapsed);
+  TimerWheelAdvancing = false;
+
+  // Wait for next expiry, if any timer is left
+  ArmTimerWheel();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gets the result entry of the latest echo request, or nullptr if not
+// recorded
+PingerProbeResult * Pinger::CurrentResult()
+{
+  u32_t index = m_pingResponse.TotalSentRequests - 1;
+  if(m_pingResponse.TotalSentRequests == 0 || index >= m_resultsCapacity)
+  {
+    return nullptr;
+  }
+
+  return &m_results[index];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Register protocol control block in LWIP, if not registered yet.
+// Return false if an error occurs
+bool Pinger::CreatePcb()
+{
+  if(m_IcmpProtocolControlBlock != nullptr)
+  {
+    return true;
+  }
+
+  // Create new ICMP detection data
+  m_IcmpProtocolControlBlock = raw_new(IP_PROTO_ICMP);
+  if(m_IcmpProtocolControlBlock == nullptr)
+  {
+    return false;
+  }
+
+  // When LWIP detects a packet corresponding to specified protocol control
+  // block, the PingReceivedStatic callback is executed
+  raw_recv(
+    m_IcmpProtocolControlBlock,
+    PingReceivedStatic,
     (void *)this);
-  os_timer_arm(&m_requestTimeoutTimer, m_pingResponse.EchoRequestTimeout, 0);
+
+  // Selects the local interfaces where detection will be made.
+  // In this case, all local interfaces
+  raw_bind(m_IcmpProtocolControlBlock, IP_ADDR_ANY);
+
+  return true;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -30,9 +30,17 @@ SOFTWARE.
 #include <functional>
 #include "core_version.h"
 #include "PingerResponse.h"
+#include "PingerBandwidthResponse.h"
+#include "PingerCapture.h"
+#include "PingerProbeResult.h"
+#include "PingerTimerWheel.h"
 
 typedef std::function<bool (const PingerResponse &)>PingerCallback;
 
+typedef std::function<void (const PingerProbeResult *, u32_t)>PingerBatchCallback;
+
+typedef std::function<bool (const PingerBandwidthResponse &)>PingerBandwidthCallback;
+
 extern "C"
 {
   #include <lwip/raw.h>
@@ -54,6 +62,22 @@ public:
   // Set callback to run when a group of ping requests is run
   void OnEnd(PingerCallback callback);
 
+  // Set callback to run when the link quality state changes
+  void OnStateChange(PingerCallback callback);
+
+  // Set callback to run when a bandwidth measurement ends
+  void OnBandwidthEnd(PingerBandwidthCallback callback);
+
+  // Set callback to run when a group of ping requests is run, receiving
+  // the results array set with SetResultBuffer() and the number of
+  // results filled. It runs before the OnEnd callback
+  void OnBatchEnd(PingerBatchCallback callback);
+
+  // Sets the array filled with one result per echo request during a ping
+  // sequence. Requests beyond capacity are not recorded. Use nullptr to
+  // stop recording results
+  void SetResultBuffer(PingerProbeResult * results, u32_t capacity);
+
   // Ping an IP address a number of times, with specified timeout.
   // Return false if an error occurs
   bool Ping(IPAddress ip, u32_t requests = 4, u32_t timeout = 1000);
@@ -62,6 +86,20 @@ public:
   // Return false if an error occurs
   bool Ping(const String & hostname, u32_t requests = 4, u32_t timeout = 1000);
 
+  // Estimate bottleneck and path capacity towards an IP address. Pairs of
+  // back-to-back echo requests are sent, pairsPerSize times for each of
+  // sizes payload lengths evenly spread between minPayload and maxPayload.
+  // At most PingerBandwidthResponse::MaxSizes sizes and
+  // PingerBandwidthResponse::MaxPairs pairs in total are allowed.
+  // Return false if an error occurs
+  bool MeasureBandwidth(
+    IPAddress ip,
+    u16_t minPayload = 32,
+    u16_t maxPayload = 1024,
+    u8_t sizes = 4,
+    u8_t pairsPerSize = 8,
+    u32_t timeout = 1000);
+
   // Sets the ID of echo request packets. Useful to filter echo responses
   // when multiple istances of present class are used.
   void SetPacketsId(u16_t id);
@@ -78,6 +116,49 @@ public:
   // Stops the Stops the specified ping sequence.
   void StopPingSequence();
 
+  // Starts answering incoming echo requests directly from the raw PCB
+  // receive callback, bypassing the LWIP icmp responder. Requests from a
+  // single source exceeding maxRequestsPerSecond are dropped (0 means no
+  // limit). If addTimestamps is true, receive and transmit timestamps are
+  // written in the echo payload, when long enough to hold them.
+  // Return false if an error occurs
+  bool StartReflector(u32_t maxRequestsPerSecond = 0, bool addTimestamps = false);
+
+  // Stops answering incoming echo requests
+  void StopReflector();
+
+  // Gets the number of echo requests answered in reflector mode
+  u32_t GetReflectedRequests();
+
+  // Gets the number of echo requests dropped by the reflector rate limit
+  u32_t GetDroppedRequests();
+
+  // Sets thresholds used to evaluate link quality. The link is degraded
+  // when smoothed response time (milliseconds) or smoothed loss (0 to 1)
+  // reach their degraded thresholds, and down when smoothed loss reaches
+  // downLoss. A worse state is left only when metrics drop below thresholds
+  // reduced by the hysteresis fraction.
+  void SetLinkQualityThresholds(
+    u32_t degradedResponseTime,
+    float degradedLoss,
+    float downLoss,
+    float hysteresis = 0.1f);
+
+  // Sets the weight of the latest probe in the moving averages, from 0 to 1
+  void SetLinkQualitySmoothing(float weight);
+
+  // Gets current link quality state
+  PingerLinkState GetLinkState();
+
+  // Forgets link quality history, restarting from the unknown state
+  void ResetLinkQuality();
+
+  // Sets the capture ring where sent and received icmp packets are
+  // recorded. Only received packets handled by present instance are
+  // recorded, so a ring can be shared by several instances.
+  // Use nullptr to disable capture
+  void SetCapture(PingerCapture * capture);
+
 protected:
   // LWIP callback run when a ping response is received (static wrapper)
   static u8_t PingReceivedStatic(
@@ -89,6 +170,35 @@ protected:
   // LWIP callback run when a ping response is received
   u8_t PingReceived(pbuf * packetBuffer, const ip_addr_t * addr);
 
+  // Record reception of an echo response belonging to a packet pair.
+  // The ->payload pointer must point to the icmp echo header
+  u8_t PacketPairReceived(pbuf * packetBuffer, u32_t receiveTimestamp);
+
+  // Account results of the current packet pair, then send the next pair
+  // or end the bandwidth measurement
+  void PacketPairCompleted();
+
+  // Send a pair of back-to-back echo requests
+  void SendPacketPair();
+
+  // Evaluate capacity estimates from collected samples
+  void EvaluateBandwidth();
+
+  // Answer an echo request in place, reusing the received packet buffer.
+  // The ->payload pointer must point to the icmp echo header
+  u8_t ReflectEchoRequest(
+    pbuf * packetBuffer,
+    const ip_addr_t * addr,
+    u32_t receiveTimestamp);
+
+  // Return true if an echo request from the specified source can be
+  // answered without exceeding the reflector rate limit
+  bool ReflectorRateAllowed(const ip_addr_t * addr);
+
+  // Record a received packet consumed by present instance.
+  // The ->payload pointer must point to the icmp header
+  void CaptureReceived(pbuf * packetBuffer);
+
   // Timer callback run when an Echo request timeout event occurs (static wrapper)
   static void TimeoutCallback(void * pinger);
 
@@ -98,9 +208,43 @@ protected:
   // Timer callback run when an Echo response is received
   static void ReceivedResponseCallback(void * pinger);
 
+  // Update link quality moving averages with a probe result, and evaluate
+  // link state. Return true if link state changed
+  bool UpdateLinkQuality(bool received, u32_t responseTime);
+
+  // Call the user defined OnStateChange callback
+  void NotifyStateChange();
+
+  // Schedule timer on the timer wheel shared by all instances, to expire
+  // after the specified number of milliseconds
+  static void ScheduleTimer(PingerTimer * timer, u32_t delay);
+
+  // Cancel timer scheduled on the shared timer wheel
+  static void CancelTimer(PingerTimer * timer);
+
+  // Arm the SDK timer for the earliest possible expiry on the shared timer
+  // wheel, unless already armed to fire earlier
+  static void ArmTimerWheel();
+
+  // SDK timer callback advancing the shared timer wheel
+  static void TimerWheelCallback(void *);
+
   // Compose echo request packet and sends it
   void BuildAndSendPacket();
 
+  // Compose an echo request with specified sequence number and payload
+  // length. Return the packet buffer, to be freed by the caller, or nullptr
+  // if an error occurs
+  struct pbuf * BuildEchoRequest(u16_t sequenceNumber, u16_t payloadLength);
+
+  // Gets the result entry of the latest echo request, or nullptr if not
+  // recorded
+  PingerProbeResult * CurrentResult();
+
+  // Register protocol control block in LWIP, if not registered yet.
+  // Return false if an error occurs
+  bool CreatePcb();
+
   // De-register protocol control block from LWIP
   void ClearPcb();
 
@@ -110,6 +254,20 @@ protected:
   // User defined callback to execute when ping sequence ends
   PingerCallback m_onEnd;
 
+  // User defined callback to execute when link quality state changes
+  PingerCallback m_onStateChange;
+
+  // User defined callback to execute when a bandwidth measurement ends
+  PingerBandwidthCallback m_onBandwidthEnd;
+
+  // User defined callback to execute when ping sequence ends, receiving
+  // all results at once
+  PingerBatchCallback m_onBatchEnd;
+
+  // User supplied array of per request results, and its capacity
+  PingerProbeResult * m_results;
+  u32_t m_resultsCapacity;
+
   // Structure containing destination data and ping sequence statistics
   PingerResponse m_pingResponse;
 
@@ -130,14 +288,100 @@ protected:
   u16_t m_echoPayloadLen;
 
   // Timer used to check echo requests timeout
-  os_timer_t m_requestTimeoutTimer;
+  PingerTimer m_requestTimeoutTimer;
 
   // Fake timer used to run the user defined OnReceive callback asynchronously
-  os_timer_t m_fakeTimer;
+  PingerTimer m_fakeTimer;
 
   // Protocol control block structure passsed to LWIP stack, used to 
   // intercept icmp packets
   struct raw_pcb * m_IcmpProtocolControlBlock;
+
+  // True while a ping sequence is running
+  bool m_sequenceInProgress;
+
+  // True when incoming echo requests are answered by present class
+  bool m_reflectorEnabled;
+
+  // True if reflected echo responses carry receive and transmit timestamps
+  bool m_reflectorTimestamps;
+
+  // Maximum echo requests per second answered for every source (0 means
+  // no limit)
+  u32_t m_reflectorMaxRate;
+
+  // Counter of echo requests answered in reflector mode
+  u32_t m_reflectedRequests;
+
+  // Counter of echo requests dropped by the reflector rate limit
+  u32_t m_droppedRequests;
+
+  // Number of sources tracked by the reflector rate limit
+  static const u8_t ReflectorSourcesCount = 8;
+
+  // Echo requests received from a single source in the current one second
+  // window
+  struct ReflectorSource
+  {
+    u32_t Address;
+    u32_t WindowStart;
+    u32_t Requests;
+  };
+
+  // Sources tracked by the reflector rate limit
+  ReflectorSource m_reflectorSources[ReflectorSourcesCount];
+
+  // Smoothed response time threshold for the degraded state, in milliseconds
+  u32_t m_degradedResponseTime;
+
+  // Smoothed loss threshold for the degraded state
+  float m_degradedLoss;
+
+  // Smoothed loss threshold for the down state
+  float m_downLoss;
+
+  // Fraction of thresholds to cross back before leaving a worse state
+  float m_linkHysteresis;
+
+  // Weight of the latest probe in the moving averages
+  float m_linkSmoothing;
+
+  // Link quality state and moving averages. They survive across ping
+  // sequences, to allow continuous monitoring
+  PingerLinkState m_linkState;
+  PingerLinkState m_previousLinkState;
+  float m_smoothedResponseTime;
+  float m_smoothedLoss;
+
+  // True once a response time has initialized its moving average
+  bool m_responseTimeSampled;
+
+  // True if the link state changed and the OnStateChange callback is still
+  // to be run
+  bool m_stateChangePending;
+
+  // Capture ring recording sent and received packets, if any
+  PingerCapture * m_capture;
+
+  // Structure containing bandwidth measurement data and results
+  PingerBandwidthResponse m_bandwidthResponse;
+
+  // True while a bandwidth measurement is running
+  bool m_bandwidthMode;
+
+  // Index of the current packet pair in the bandwidth measurement
+  u32_t m_pairIndex;
+
+  // Sequence number of the first echo request of the current pair. Pair
+  // sequence numbers range from 0x8000, disjoint from ping sequences
+  u16_t m_pairSequenceNumber;
+
+  // Send and receive timestamps of the current pair, in microseconds
+  u32_t m_pairSendTimestamp[2];
+  u32_t m_pairReceiveTimestamp[2];
+
+  // True for every echo request of the current pair answered
+  bool m_pairReceived[2];
 };
 
 #endif // ESP8266_Pinger_Arduino_Library
\ No newline at end of file
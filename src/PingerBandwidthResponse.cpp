@@ -0,0 +1,69 @@
+/*****************************************************************************
+Arduino library handling ping messages for the esp8266 platform
+
+MIT License
+
+Copyright (c) 2018 Alessio Leoncini
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*****************************************************************************/
+
+#include "PingerBandwidthResponse.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Constructor
+PingerBandwidthResponse::PingerBandwidthResponse()
+{
+  Reset();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Destructor
+PingerBandwidthResponse::~PingerBandwidthResponse()
+{
+  Reset();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Reset class
+void PingerBandwidthResponse::Reset()
+{
+  DestIPAddress = IPAddress(0, 0, 0, 0);
+  Sizes = 0;
+  for(u8_t i = 0; i < MaxSizes; i++)
+  {
+    PayloadLengths[i] = 0;
+    MinResponseTimes[i] = 0xffffffff;
+  }
+  for(u8_t i = 0; i < MaxPairs; i++)
+  {
+    PacketPairEstimates[i] = 0.f;
+  }
+  PacketPairSamples = 0;
+  PacketPairCapacity = 0.f;
+  PacketPairDeviation = 0.f;
+  SerializationDelay = 0.f;
+  SerializationDelayError = 0.f;
+  BaseResponseTime = 0.f;
+  FitQuality = 0.f;
+  PathCapacity = 0.f;
+  TotalSentRequests = 0;
+  TotalReceivedResponses = 0;
+  EchoRequestTimeout = 0;
+}
@@ -0,0 +1,105 @@
+/*****************************************************************************
+Arduino library handling ping messages for the esp8266 platform
+
+MIT License
+
+Copyright (c) 2018 Alessio Leoncini
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*****************************************************************************/
+
+#ifndef ESP8266_PingerBandwidthResponse_Arduino_Library
+#define ESP8266_PingerBandwidthResponse_Arduino_Library
+
+#include "IPAddress.h"
+
+class PingerBandwidthResponse
+{
+public:
+  // Maximum number of different payload lengths in a measurement
+  static const u8_t MaxSizes = 8;
+
+  // Maximum number of packet pairs in a measurement
+  static const u8_t MaxPairs = 32;
+
+  // Constructor
+  PingerBandwidthResponse();
+
+  // Destructor
+  virtual ~PingerBandwidthResponse();
+
+  // Reset class
+  void Reset();
+
+  // Destination IP Address
+  IPAddress DestIPAddress;
+
+  // Number of different payload lengths used
+  u8_t Sizes;
+
+  // Echo payload length for every size, in bytes
+  u16_t PayloadLengths[MaxSizes];
+
+  // Minimum response time for every size, in microseconds.
+  // 0xffffffff if no response received for such size
+  u32_t MinResponseTimes[MaxSizes];
+
+  // Capacity estimated by every packet pair, in bits per second
+  float PacketPairEstimates[MaxPairs];
+
+  // Number of valid packet pair estimates
+  u8_t PacketPairSamples;
+
+  // Bottleneck capacity, median of packet pair estimates, in bits per
+  // second. 0 if no pair was received
+  float PacketPairCapacity;
+
+  // Median absolute deviation of packet pair estimates, relative to
+  // PacketPairCapacity. Lower values mean more consistent estimates
+  float PacketPairDeviation;
+
+  // One way serialization delay, in microseconds per byte, from the linear
+  // regression of minimum response time over packet size
+  float SerializationDelay;
+
+  // Standard error of SerializationDelay, in microseconds per byte
+  float SerializationDelayError;
+
+  // Response time extrapolated for an empty packet, in microseconds
+  float BaseResponseTime;
+
+  // Coefficient of determination of the regression, from 0 to 1. Values
+  // close to 1 mean that response time grows linearly with packet size
+  float FitQuality;
+
+  // Path capacity evaluated from SerializationDelay, in bits per second.
+  // 0 if the regression could not be evaluated
+  float PathCapacity;
+
+  // Total sent requests
+  u32_t TotalSentRequests;
+
+  // Total received responses
+  u32_t TotalReceivedResponses;
+
+  // Timeout in milliseconds
+  u32_t EchoRequestTimeout;
+};
+
+#endif // ESP8266_PingerBandwidthResponse_Arduino_Library
@@ -0,0 +1,249 @@
+/*****************************************************************************
+Arduino library handling ping messages for the esp8266 platform
+
+MIT License
+
+Copyright (c) 2018 Alessio Leoncini
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*****************************************************************************/
+
+#include "PingerCapture.h"
+
+#include <new> // needed for std::nothrow
+
+extern "C"
+{
+  #include <lwip/inet_chksum.h> // needed for inet_chksum()
+  #include <user_interface.h> // needed for system_get_time()
+}
+
+// Size of the IPv4 header prepended to outgoing icmp messages
+static const u16_t CaptureIpHeaderLen = 20;
+
+// Pcap link type for packets beginning with the IPv4 header
+static const u32_t CaptureLinkTypeRaw = 101;
+
+//////////////////////////////////////////////////////////////////////////////
+// Constructor
+PingerCapture::PingerCapture()
+{
+  m_buffer = nullptr;
+  m_slots = 0;
+  m_snapLength = 0;
+  Clear();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Destructor
+PingerCapture::~PingerCapture()
+{
+  End();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Allocate room for the specified number of packets, each one truncated
+// to snapLength bytes. Return false if an error occurs
+bool PingerCapture::Begin(u16_t packets, u16_t snapLength)
+{
+  End();
+
+  // Snap length must hold the IPv4 header, and must not wrap when rounded
+  if(packets == 0 || snapLength < CaptureIpHeaderLen || snapLength > 0xfffc)
+  {
+    return false;
+  }
+
+  // Round slot size up to keep record headers 32 bit aligned
+  snapLength = (snapLength + 3) & ~3;
+
+  // Plain new aborts when out of memory on esp8266 cores
+  size_t bufferSize = (size_t)packets * (sizeof(RecordHeader) + snapLength);
+  m_buffer = new (std::nothrow) u8_t[bufferSize];
+  if(m_buffer == nullptr)
+  {
+    return false;
+  }
+
+  m_slots = packets;
+  m_snapLength = snapLength;
+  Clear();
+
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Release capture memory
+void PingerCapture::End()
+{
+  delete[] m_buffer;
+  m_buffer = nullptr;
+  m_slots = 0;
+  m_snapLength = 0;
+  Clear();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Forget captured packets, keeping capture memory
+void PingerCapture::Clear()
+{
+  m_head = 0;
+  m_count = 0;
+  m_lastTimestamp = 0;
+  m_timestampOverflows = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Record an IPv4 packet. The ->payload pointer must point to the IPv4
+// header
+void PingerCapture::CaptureIncoming(const pbuf * packetBuffer)
+{
+  if(m_buffer == nullptr || packetBuffer == nullptr)
+  {
+    return;
+  }
+
+  u16_t capturedLength = packetBuffer->tot_len < m_snapLength ?
+    packetBuffer->tot_len : m_snapLength;
+  u8_t * data = NextRecord(packetBuffer->tot_len, capturedLength);
+
+  // The packet buffer can be a chain, so copy it piece by piece
+  pbuf_copy_partial((pbuf *)packetBuffer, data, capturedLength, 0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Record an outgoing icmp message, prepending an approximation of the IPv4
+// header that LWIP will build for it. The ->payload pointer must point to
+// the icmp header
+void PingerCapture::CaptureOutgoing(
+  const pbuf * packetBuffer,
+  u32_t source,
+  u32_t destination,
+  u8_t ttl)
+{
+  if(m_buffer == nullptr || packetBuffer == nullptr)
+  {
+    return;
+  }
+
+  u16_t originalLength = packetBuffer->tot_len + CaptureIpHeaderLen;
+  u16_t capturedLength = originalLength < m_snapLength ?
+    originalLength : m_snapLength;
+  u8_t * data = NextRecord(originalLength, capturedLength);
+
+  // Build the IPv4 header. Identification is chosen by LWIP at send time,
+  // and no flag is set by raw sockets, so both are left to zero
+  u16_t totalLength = htons(originalLength);
+  memset(data, 0, CaptureIpHeaderLen);
+  data[0] = 0x45; // IPv4, 5 words long header
+  memcpy(&data[2], &totalLength, sizeof(totalLength));
+  data[8] = ttl;
+  data[9] = 1; // icmp protocol
+  memcpy(&data[12], &source, sizeof(source));
+  memcpy(&data[16], &destination, sizeof(destination));
+  u16_t checksum = inet_chksum(data, CaptureIpHeaderLen);
+  memcpy(&data[10], &checksum, sizeof(checksum));
+
+  // Append the icmp message
+  pbuf_copy_partial(
+    (pbuf *)packetBuffer,
+    data + CaptureIpHeaderLen,
+    capturedLength - CaptureIpHeaderLen,
+    0);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gets the number of packets currently held
+u16_t PingerCapture::GetCapturedPackets()
+{
+  return m_count;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Write captured packets, oldest first, as a pcap stream (raw IPv4 link
+// type). Return the number of bytes written
+size_t PingerCapture::Export(Print & output)
+{
+  // Pcap global header, in native byte order as allowed by the format
+  u32_t globalHeader[6];
+  globalHeader[0] = 0xa1b2c3d4; // microsecond resolution magic number
+  globalHeader[1] = 2 | (4 << 16); // version 2.4
+  globalHeader[2] = 0; // GMT timezone
+  globalHeader[3] = 0; // timestamps accuracy
+  globalHeader[4] = m_snapLength;
+  globalHeader[5] = CaptureLinkTypeRaw;
+  size_t written = output.write((const uint8_t *)globalHeader,
+    sizeof(globalHeader));
+
+  // Captured packets, from the oldest one
+  size_t slotSize = sizeof(RecordHeader) + m_snapLength;
+  u16_t slot = (m_head + m_slots - m_count) % (m_slots > 0 ? m_slots : 1);
+  for(u16_t i = 0; i < m_count; i++)
+  {
+    const u8_t * record = m_buffer + slot * slotSize;
+    const RecordHeader * header = (const RecordHeader *)record;
+    written += output.write(record,
+      sizeof(RecordHeader) + header->CapturedLength);
+
+    ++slot;
+    if(slot == m_slots)
+    {
+      slot = 0;
+    }
+  }
+
+  return written;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Reserve the slot of next packet, overwriting the oldest one if the
+// ring is full, and fill its header
+u8_t * PingerCapture::NextRecord(u32_t originalLength, u32_t capturedLength)
+{
+  u8_t * record = m_buffer + m_head * (sizeof(RecordHeader) + m_snapLength);
+
+  // Extend the 32 bit microsecond system time, that overflows about
+  // every 71 minutes
+  u32_t now = system_get_time();
+  if(now < m_lastTimestamp)
+  {
+    ++m_timestampOverflows;
+  }
+  m_lastTimestamp = now;
+  uint64_t timestamp = ((uint64_t)m_timestampOverflows << 32) | now;
+
+  RecordHeader * header = (RecordHeader *)record;
+  header->Seconds = timestamp / 1000000;
+  header->Microseconds = timestamp % 1000000;
+  header->CapturedLength = capturedLength;
+  header->OriginalLength = originalLength;
+
+  // Advance ring position
+  ++m_head;
+  if(m_head == m_slots)
+  {
+    m_head = 0;
+  }
+  if(m_count < m_slots)
+  {
+    ++m_count;
+  }
+
+  return record + sizeof(RecordHeader);
+}
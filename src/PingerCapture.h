@@ -0,0 +1,114 @@
+/*****************************************************************************
+Arduino library handling ping messages for the esp8266 platform
+
+MIT License
+
+Copyright (c) 2018 Alessio Leoncini
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*****************************************************************************/
+
+#ifndef ESP8266_PingerCapture_Arduino_Library
+#define ESP8266_PingerCapture_Arduino_Library
+
+#include "Print.h"
+
+extern "C"
+{
+  #include <lwip/pbuf.h>
+}
+
+class PingerCapture
+{
+public:
+  // Constructor
+  PingerCapture();
+
+  // Destructor
+  virtual ~PingerCapture();
+
+  // Allocate room for the specified number of packets, each one truncated
+  // to snapLength bytes. Memory is allocated here only, so that capturing
+  // a packet costs a bounded copy. Return false if an error occurs
+  bool Begin(u16_t packets = 16, u16_t snapLength = 96);
+
+  // Release capture memory
+  void End();
+
+  // Forget captured packets, keeping capture memory
+  void Clear();
+
+  // Record an IPv4 packet. The ->payload pointer must point to the IPv4
+  // header
+  void CaptureIncoming(const pbuf * packetBuffer);
+
+  // Record an outgoing icmp message, prepending an approximation of the
+  // IPv4 header that LWIP will build for it: identification and flags are
+  // left to zero. The source address must be the one of the interface the
+  // message leaves from. The ->payload pointer must point to the icmp header
+  void CaptureOutgoing(
+    const pbuf * packetBuffer,
+    u32_t source,
+    u32_t destination,
+    u8_t ttl);
+
+  // Gets the number of packets currently held
+  u16_t GetCapturedPackets();
+
+  // Write captured packets, oldest first, as a pcap stream (raw IPv4 link
+  // type). Return the number of bytes written
+  size_t Export(Print & output);
+
+protected:
+  // Pcap record header, stored in front of every captured packet
+  struct RecordHeader
+  {
+    u32_t Seconds;
+    u32_t Microseconds;
+    u32_t CapturedLength;
+    u32_t OriginalLength;
+  };
+
+  // Reserve the slot of next packet, overwriting the oldest one if the
+  // ring is full, and fill its header
+  u8_t * NextRecord(u32_t originalLength, u32_t capturedLength);
+
+  // Preallocated ring of fixed size slots: record header followed by
+  // snapLength packet bytes
+  u8_t * m_buffer;
+
+  // Number of slots in the ring
+  u16_t m_slots;
+
+  // Maximum number of bytes stored for every packet
+  u16_t m_snapLength;
+
+  // Slot where the next packet will be written
+  u16_t m_head;
+
+  // Number of packets currently held
+  u16_t m_count;
+
+  // Last microsecond timestamp and number of its overflows, used to build
+  // 64 bit timestamps from the 32 bit system time
+  u32_t m_lastTimestamp;
+  u32_t m_timestampOverflows;
+};
+
+#endif // ESP8266_PingerCapture_Arduino_Library
@@ -0,0 +1,60 @@
+/*****************************************************************************
+Arduino library handling ping messages for the esp8266 platform
+
+MIT License
+
+Copyright (c) 2018 Alessio Leoncini
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*****************************************************************************/
+
+#ifndef ESP8266_PingerProbeResult_Arduino_Library
+#define ESP8266_PingerProbeResult_Arduino_Library
+
+extern "C"
+{
+  #include <lwip/arch.h> // required for u16_t and u32_t
+}
+
+// Outcome of a single echo request
+enum class PingerProbeStatus : u8_t
+{
+  Pending,
+  Received,
+  Timeout
+};
+
+// Result of a single echo request of a ping sequence, stored in the
+// caller supplied array passed to Pinger::SetResultBuffer()
+struct PingerProbeResult
+{
+  // Sequence number of the echo request
+  u16_t SequenceNumber;
+
+  // Time to live of the echo response
+  u8_t TimeToLive;
+
+  // Echo request outcome
+  PingerProbeStatus Status;
+
+  // Response time in milliseconds
+  u32_t ResponseTime;
+};
+
+#endif // ESP8266_PingerProbeResult_Arduino_Library
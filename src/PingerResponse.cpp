@@ -55,8 +55,13 @@ void PingerResponse::Reset()
   SequenceNumber = 0;
   ReceivedResponse = false;
   TimeToLive = 0;
+  RemoteProcessingTime = 0;
   TotalSentRequests = 0;
   TotalReceivedResponses = 0;
   TotalPingingTime = 0;
   EchoRequestTimeout = 0;
+  SmoothedResponseTime = 0.f;
+  SmoothedLoss = 0.f;
+  LinkState = PingerLinkState::Unknown;
+  PreviousLinkState = PingerLinkState::Unknown;
 }
\ No newline at end of file
@@ -34,6 +34,15 @@ extern "C"
   #include <netif/etharp.h> // required for eth_addr
 }
 
+// Link quality evaluated over the probe stream, from best to worst
+enum class PingerLinkState
+{
+  Unknown,
+  Healthy,
+  Degraded,
+  Down
+};
+
 class PingerResponse
 {
 public:
@@ -79,6 +88,11 @@ public:
   // Time to live
   u16_t TimeToLive;
 
+  // Time spent by the remote host between echo request reception and echo
+  // response transmission, in microseconds. Available only when the remote
+  // host is a Pinger in reflector mode with timestamps enabled, 0 otherwise
+  u32_t RemoteProcessingTime;
+
   // Total sent requests
   u32_t TotalSentRequests;
 
@@ -90,6 +104,18 @@ public:
 
   // Timeout in milliseconds
   u32_t EchoRequestTimeout;
+
+  // Exponentially weighted moving average of response time, in milliseconds
+  float SmoothedResponseTime;
+
+  // Exponentially weighted moving average of packet loss, from 0 to 1
+  float SmoothedLoss;
+
+  // Link quality state
+  PingerLinkState LinkState;
+
+  // Link quality state before last transition
+  PingerLinkState PreviousLinkState;
 };
 
 #endif // ESP8266_PingerResponse_Arduino_Library
\ No newline at end of file
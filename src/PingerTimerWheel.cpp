@@ -0,0 +1,287 @@
+/*****************************************************************************
+Arduino library handling ping messages for the esp8266 platform
+
+MIT License
+
+Copyright (c) 2018 Alessio Leoncini
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*****************************************************************************/
+
+#include "PingerTimerWheel.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Constructor
+PingerTimer::PingerTimer()
+{
+  m_function = nullptr;
+  m_arg = nullptr;
+  m_expiry = 0;
+  m_level = 0;
+  m_next = nullptr;
+  m_prevNext = nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Set function to run, and its argument, when the timer expires
+void PingerTimer::SetCallback(PingerTimerFunction function, void * arg)
+{
+  m_function = function;
+  m_arg = arg;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Return true if the timer is scheduled
+bool PingerTimer::IsPending() const
+{
+  return m_prevNext != nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Constructor
+PingerTimerWheel::PingerTimerWheel()
+{
+  for(uint8_t level = 0; level < Levels; level++)
+  {
+    for(uint32_t slot = 0; slot < Slots; slot++)
+    {
+      m_slots[level][slot] = nullptr;
+    }
+    m_levelTimers[level] = 0;
+  }
+  m_now = 0;
+  m_target = 0;
+  m_pendingTimers = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Schedule timer to expire after the specified number of ticks
+void PingerTimerWheel::Schedule(PingerTimer * timer, uint32_t delay)
+{
+  Cancel(timer);
+  timer->m_expiry = m_target + delay;
+  Insert(timer);
+  ++m_pendingTimers;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Cancel timer. Nothing happens if the timer is not scheduled
+void PingerTimerWheel::Cancel(PingerTimer * timer)
+{
+  if(timer->m_prevNext == nullptr)
+  {
+    return;
+  }
+
+  *(timer->m_prevNext) = timer->m_next;
+  if(timer->m_next != nullptr)
+  {
+    timer->m_next->m_prevNext = timer->m_prevNext;
+  }
+  timer->m_next = nullptr;
+  timer->m_prevNext = nullptr;
+  --m_levelTimers[timer->m_level];
+  --m_pendingTimers;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Advance time by the specified number of ticks, running the function of
+// every expired timer
+void PingerTimerWheel::Advance(uint32_t ticks)
+{
+  m_target = m_now + ticks;
+
+  while(ticks > 0)
+  {
+    // Nothing can happen before the earliest possible expiry, included
+    // cascades, so jump there directly
+    uint32_t idle = GetTicksToNextExpiry();
+    if(idle >= ticks)
+    {
+      m_now += ticks;
+      return;
+    }
+    m_now += idle;
+    ticks -= idle;
+
+    Tick();
+    --ticks;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gets current time, in ticks
+uint32_t PingerTimerWheel::GetTime() const
+{
+  return m_now;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gets the number of scheduled timers
+uint32_t PingerTimerWheel::GetPendingTimers() const
+{
+  return m_pendingTimers;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gets the number of ticks after which the earliest scheduled timer may
+// expire
+uint32_t PingerTimerWheel::GetTicksToNextExpiry() const
+{
+  uint32_t next = 0xffffffff;
+
+  for(uint8_t level = 0; level < Levels; level++)
+  {
+    if(m_levelTimers[level] == 0)
+    {
+      continue;
+    }
+
+    uint8_t shift = SlotBits * level;
+    uint32_t block = m_now >> shift;
+    uint32_t index = block & SlotMask;
+
+    // Upper level current slot is cascaded when the lower levels wrap. If
+    // that already happened, it holds timers one whole turn ahead
+    bool cascaded = level > 0 && (m_now & (((uint32_t)1 << shift) - 1)) != 0;
+
+    // The first non empty slot gives the earliest block where its timers
+    // can expire. Level 0 blocks are single ticks, so the value is exact
+    for(uint32_t distance = 0; distance < Slots; distance++)
+    {
+      if(m_slots[level][(index + distance) & SlotMask] == nullptr)
+      {
+        continue;
+      }
+
+      uint32_t blocks = (distance == 0 && cascaded) ? Slots : distance;
+      uint32_t ticks = ((block + blocks) << shift) - m_now;
+      if(ticks < next)
+      {
+        next = ticks;
+      }
+
+      // Later slots of present level expire later
+      if(distance > 0)
+      {
+        break;
+      }
+    }
+  }
+
+  return next;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Process a single tick: cascade upper levels if lower ones wrap, then
+// run expired timers
+void PingerTimerWheel::Tick()
+{
+  // When lower level wraps, bring timers of the next upper level slot
+  // down. Upper levels are cascaded only when lower ones wrap as well
+  uint32_t slot = m_now & SlotMask;
+  if(slot == 0)
+  {
+    for(uint8_t level = 1; level < Levels; level++)
+    {
+      if(Cascade(level) != 0)
+      {
+        break;
+      }
+    }
+  }
+
+  ++m_now;
+
+  // Detach expired timers, so that timers scheduled by their functions
+  // land in the slot list rather than in the one being run
+  PingerTimer * expired = m_slots[0][slot];
+  m_slots[0][slot] = nullptr;
+  if(expired != nullptr)
+  {
+    expired->m_prevNext = &expired;
+  }
+
+  // Run expired timers. Every timer is unlinked before running its
+  // function, which is then free to schedule or cancel any timer
+  while(expired != nullptr)
+  {
+    PingerTimer * timer = expired;
+    Cancel(timer);
+    if(timer->m_function != nullptr)
+    {
+      timer->m_function(timer->m_arg);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Link timer in the slot matching its expiry time
+void PingerTimerWheel::Insert(PingerTimer * timer)
+{
+  uint32_t delta = timer->m_expiry - m_now;
+
+  // Find the lowest level able to hold the timer. Timers too far in the
+  // future are parked in the last level slot reached by the wheel range,
+  // and get inserted again when such slot is cascaded
+  uint8_t level = 0;
+  uint32_t expiry = timer->m_expiry;
+  while(level < Levels - 1 && delta >= ((uint32_t)1 << (SlotBits * (level + 1))))
+  {
+    ++level;
+  }
+  uint32_t range = (uint32_t)1 << (SlotBits * Levels);
+  if(delta >= range)
+  {
+    expiry = m_now + range - 1;
+  }
+
+  PingerTimer ** head =
+    &m_slots[level][(expiry >> (SlotBits * level)) & SlotMask];
+  timer->m_next = *head;
+  timer->m_prevNext = head;
+  if(*head != nullptr)
+  {
+    (*head)->m_prevNext = &timer->m_next;
+  }
+  *head = timer;
+  timer->m_level = level;
+  ++m_levelTimers[level];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Move timers of the current slot of specified level into lower levels.
+// Return the index of such slot
+uint32_t PingerTimerWheel::Cascade(uint8_t level)
+{
+  uint32_t slot = (m_now >> (SlotBits * level)) & SlotMask;
+
+  // Detach the whole list, then insert its timers again
+  PingerTimer * timer = m_slots[level][slot];
+  m_slots[level][slot] = nullptr;
+  while(timer != nullptr)
+  {
+    PingerTimer * next = timer->m_next;
+    --m_levelTimers[level];
+    Insert(timer);
+    timer = next;
+  }
+
+  return slot;
+}
@@ -0,0 +1,142 @@
+/*****************************************************************************
+Arduino library handling ping messages for the esp8266 platform
+
+MIT License
+
+Copyright (c) 2018 Alessio Leoncini
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*****************************************************************************/
+
+#ifndef ESP8266_PingerTimerWheel_Arduino_Library
+#define ESP8266_PingerTimerWheel_Arduino_Library
+
+// Present file depends on the standard library only, so that the timer
+// wheel can be built and benchmarked on the host as well
+#include <stdint.h>
+
+// Function run when a timer expires
+typedef void (*PingerTimerFunction)(void * arg);
+
+// Timer scheduled on a PingerTimerWheel. Timers are linked directly into
+// the wheel slots, so they must stay valid while scheduled
+class PingerTimer
+{
+public:
+  // Constructor
+  PingerTimer();
+
+  // Set function to run, and its argument, when the timer expires
+  void SetCallback(PingerTimerFunction function, void * arg);
+
+  // Return true if the timer is scheduled
+  bool IsPending() const;
+
+protected:
+  friend class PingerTimerWheel;
+
+  // Function to run and its argument
+  PingerTimerFunction m_function;
+  void * m_arg;
+
+  // Absolute expiry time, in ticks
+  uint32_t m_expiry;
+
+  // Wheel level holding the timer
+  uint8_t m_level;
+
+  // Next timer in the same slot
+  PingerTimer * m_next;
+
+  // Pointer to the reference to present timer in the slot list, or
+  // nullptr if not scheduled. Allows unlinking without walking the list
+  PingerTimer ** m_prevNext;
+};
+
+// Hierarchical timer wheel. Scheduling and cancelling cost O(1). Advancing
+// costs expired timers plus occasional cascades of timers from upper levels
+// to lower ones, while ticks where nothing can happen are skipped at once
+class PingerTimerWheel
+{
+public:
+  // Constructor
+  PingerTimerWheel();
+
+  // Schedule timer to expire after the specified number of ticks. If the
+  // timer is already scheduled, it is rescheduled. Timers scheduled by
+  // expired functions count their delay from the end of the running
+  // advance, as the caller's clock is already there
+  void Schedule(PingerTimer * timer, uint32_t delay);
+
+  // Cancel timer. Nothing happens if the timer is not scheduled
+  void Cancel(PingerTimer * timer);
+
+  // Advance time by the specified number of ticks, running the function of
+  // every expired timer
+  void Advance(uint32_t ticks);
+
+  // Gets current time, in ticks
+  uint32_t GetTime() const;
+
+  // Gets the number of scheduled timers
+  uint32_t GetPendingTimers() const;
+
+  // Gets the number of ticks after which the earliest scheduled timer may
+  // expire. The value is exact for timers expiring within Slots ticks, and
+  // a lower bound for later ones. Meaningless if no timer is scheduled
+  uint32_t GetTicksToNextExpiry() const;
+
+protected:
+  // Number of levels of the wheel and number of slots for each level.
+  // Level n slots span 64^n ticks, so the wheel covers 2^24 ticks; timers
+  // expiring later are parked in the last level and cascaded again
+  static const uint8_t Levels = 4;
+  static const uint8_t SlotBits = 6;
+  static const uint32_t Slots = 1 << SlotBits;
+  static const uint32_t SlotMask = Slots - 1;
+
+  // Process a single tick: cascade upper levels if lower ones wrap, then
+  // run expired timers
+  void Tick();
+
+  // Link timer in the slot matching its expiry time
+  void Insert(PingerTimer * timer);
+
+  // Move timers of the current slot of specified level into lower levels.
+  // Return the index of such slot
+  uint32_t Cascade(uint8_t level);
+
+  // Lists of timers, for every level and slot
+  PingerTimer * m_slots[Levels][Slots];
+
+  // Next tick to be processed
+  uint32_t m_now;
+
+  // Time reached at the end of the running advance, equal to m_now
+  // otherwise. Delays of new timers count from here
+  uint32_t m_target;
+
+  // Number of scheduled timers
+  uint32_t m_pendingTimers;
+
+  // Number of scheduled timers for every level, used to skip empty levels
+  uint32_t m_levelTimers[Levels];
+};
+
+#endif // ESP8266_PingerTimerWheel_Arduino_Library